@@ -1,10 +1,22 @@
 #include "SimpleGameEngine.hpp"
 #include <cmath>
+#include <algorithm>
 
 const int FONT_SIZE = 18;
 const int FONT_WIDTH = 10;
 const int FONT_HEIGHT = 18;
 
+// quality governor tuning, the gap between the two ratios and the frame counts provide hysteresis
+const float GOVERNOR_SMOOTHING = 0.1f;      // weight of the newest frame in the moving average
+const float GOVERNOR_DEGRADE_RATIO = 1.0f;  // step down when smoothed frame time is above the target
+const float GOVERNOR_RECOVER_RATIO = 0.6f;  // step up only when comfortably below the target
+const int GOVERNOR_DEGRADE_FRAMES = 30;
+const int GOVERNOR_RECOVER_FRAMES = 180;
+const int GOVERNOR_SETTLE_FRAMES = 60;      // frames after a level change before the new level is judged
+const int GOVERNOR_RETRY_FRAMES = 600;      // calm frames before retrying a level above despite its stored cost
+const int GOVERNOR_RETRY_WINDOW = 600;      // a recovered level that degrades sooner than this doubles the retry wait
+const int GOVERNOR_MAX_RETRY_BACKOFF = 32;
+
 SDL_Renderer *gRenderer = nullptr;
 TTF_Font *gFont = NULL;
 LTexture::LTexture() {
@@ -61,7 +73,10 @@ bool LTexture::loadTextureFromText(const std::string &text, SDL_Color color) {
 }
 
 
-GameEngine::GameEngine(): mWindowWidth(80), mWindowHeight(40), gWindow(nullptr){
+GameEngine::GameEngine(): mWindowWidth(80), mWindowHeight(40), gWindow(nullptr), mTargetFrameTime(1.0f / 60.0f),
+                          mSmoothedFrameTime(0.0f), mOverBudgetFrames(0), mUnderBudgetFrames(0), mQualityLevel(QUALITY_FULL),
+                          mLevelFrameTime(), mSettledFrameTime(0.0f), mFramesAtLevel(0),
+                          mRecoveredToLevel(false), mRetryBackoff(1){
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         std::cout << "SDL initialization failed: " << SDL_GetError();
     }
@@ -197,6 +212,9 @@ void GameEngine::startGameLoop() {
         if(!onFrameUpdate(frameElapsedTime)){
             quit = true;
         }
+        // measure the work done this frame before presenting, the vsync wait inside present would hide any headroom
+        std::chrono::duration<float> frameWorkTime = std::chrono::system_clock::now() - currFrameTime;
+        updateQualityGovernor(frameWorkTime.count());
 
         // 4. RENDER OUTPUT
 
@@ -208,6 +226,80 @@ void GameEngine::startGameLoop() {
     }
 }
 
+bool GameEngine::setTargetFrameTime(float secPerFrame) {
+    if (!(secPerFrame > 0.0f) || !std::isfinite(secPerFrame)) {
+        std::cout << "Invalid target frame time: " << secPerFrame << " s, keeping " << mTargetFrameTime << " s" << std::endl;
+        return false;
+    }
+    mTargetFrameTime = secPerFrame;
+    return true;
+}
+
+int GameEngine::getQualityLevel() const { return mQualityLevel; }
+
+// Steps the quality level down when frames keep exceeding the target time and back up once there is enough headroom
+void GameEngine::updateQualityGovernor(float frameWorkTime) {
+    mSmoothedFrameTime += GOVERNOR_SMOOTHING * (frameWorkTime - mSmoothedFrameTime);
+    mFramesAtLevel++;
+    if (mFramesAtLevel == GOVERNOR_SETTLE_FRAMES) {
+        mSettledFrameTime = mSmoothedFrameTime;
+    }
+    if (mRecoveredToLevel && mFramesAtLevel == GOVERNOR_RETRY_WINDOW) {
+        // the level we stepped up to has held, so the next blind retry can come quickly again
+        mRetryBackoff = 1;
+    }
+
+    if (mFramesAtLevel < GOVERNOR_SETTLE_FRAMES) {
+        // the moving average still reflects the previous level, judging this one now could skip past it
+        mOverBudgetFrames = 0;
+        mUnderBudgetFrames = 0;
+    } else if (mSmoothedFrameTime > mTargetFrameTime * GOVERNOR_DEGRADE_RATIO) {
+        mOverBudgetFrames++;
+        mUnderBudgetFrames = 0;
+    } else if (mSmoothedFrameTime < mTargetFrameTime * GOVERNOR_RECOVER_RATIO) {
+        mUnderBudgetFrames++;
+        mOverBudgetFrames = 0;
+    } else {
+        mOverBudgetFrames = 0;
+        mUnderBudgetFrames = 0;
+    }
+
+    int newLevel = mQualityLevel;
+    if (mOverBudgetFrames >= GOVERNOR_DEGRADE_FRAMES && mQualityLevel < QUALITY_LEVEL_COUNT - 1) {
+        newLevel = mQualityLevel + 1;
+        if (mRecoveredToLevel && mFramesAtLevel < GOVERNOR_RETRY_WINDOW) {
+            // a level we just stepped up to didn't hold, wait longer before trying it again
+            mRetryBackoff = std::min(mRetryBackoff * 2, GOVERNOR_MAX_RETRY_BACKOFF);
+        }
+    } else if (mUnderBudgetFrames >= GOVERNOR_RECOVER_FRAMES && mQualityLevel > QUALITY_FULL) {
+        // Being under budget here says nothing about the level above, which may be the one we just left.
+        // Estimate its cost now by scaling the time it last took by how much this level has sped up since we arrived,
+        // and step up if that fits the budget.
+        // The stored time can be stale, e.g. taken during a short spike, so after a long enough calm stretch the level
+        // above is retried anyway, waiting longer each time such a retry fails
+        float aboveFrameTime = mLevelFrameTime[mQualityLevel - 1];
+        float predictedFrameTime = 0.0f;
+        if (aboveFrameTime > 0.0f && mSettledFrameTime > 0.0f) {
+            predictedFrameTime = aboveFrameTime * mSmoothedFrameTime / mSettledFrameTime;
+        }
+        if (predictedFrameTime <= mTargetFrameTime * GOVERNOR_DEGRADE_RATIO ||
+            mUnderBudgetFrames >= GOVERNOR_RETRY_FRAMES * mRetryBackoff) {
+            newLevel = mQualityLevel - 1;
+        }
+    }
+    if (newLevel != mQualityLevel) {
+        std::cout << "Quality level " << mQualityLevel << " -> " << newLevel << " (frame time "
+                  << mSmoothedFrameTime * 1000.0f << " ms, target " << mTargetFrameTime * 1000.0f << " ms)" << std::endl;
+        mLevelFrameTime[mQualityLevel] = mSmoothedFrameTime;
+        mRecoveredToLevel = newLevel < mQualityLevel;
+        mQualityLevel = newLevel;
+        mSettledFrameTime = 0.0f;
+        mFramesAtLevel = 0;
+        mOverBudgetFrames = 0;
+        mUnderBudgetFrames = 0;
+    }
+}
+
 void GameEngine::onKeyboardEvent(int keycode, float secPerFrame) {}
 
 void
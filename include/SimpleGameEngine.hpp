@@ -37,6 +37,16 @@ typedef struct ConsoleInfo{
     char *screenBuffer;
 } ConsoleInfo;
 
+// Quality levels stepped through by the frame-time governor, each one includes the savings of the previous ones
+enum QualityLevel {
+    QUALITY_FULL = 0,
+    QUALITY_REDUCED_LOD,   // fewer vertices for small or distant models
+    QUALITY_OUTLINE_ONLY,  // skip filling shapes, draw outlines only
+    QUALITY_REDUCED_HUD,   // refresh text textures less often
+    QUALITY_SUBSAMPLED,    // simulate far objects every other frame
+    QUALITY_LEVEL_COUNT
+};
+
 struct Color {
     unsigned char r;
     unsigned char g;
@@ -50,7 +60,18 @@ protected:
     SDL_Event e;
 private:
     void initScreen();
+    void updateQualityGovernor(float frameWorkTime);
     SDL_Window *gWindow = nullptr;
+    float mTargetFrameTime;
+    float mSmoothedFrameTime;
+    int mOverBudgetFrames;
+    int mUnderBudgetFrames;
+    int mQualityLevel;
+    float mLevelFrameTime[QUALITY_LEVEL_COUNT]; // smoothed frame time when each level was last left, 0 if never left
+    float mSettledFrameTime; // smoothed frame time once settled at the current level, 0 until then
+    int mFramesAtLevel;
+    bool mRecoveredToLevel; // the current level was reached by stepping up
+    int mRetryBackoff; // multiplier on the wait before retrying a level above that is predicted not to fit
 public:
     GameEngine();
 
@@ -77,6 +98,10 @@ public:
 
     void startGameLoop();
 
+    bool setTargetFrameTime(float secPerFrame);
+
+    int getQualityLevel() const;
+
     void close_sdl();
 
     ~GameEngine();
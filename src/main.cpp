@@ -3,9 +3,19 @@
 #include <vector>
 #include <cmath>
 #include <utility>
+#include <cstdlib>
+#include <algorithm>
 
 int CURRENT_ID = 0;
 
+// thresholds used when the engine lowers the quality level
+const int LOD_MAX_SIZE = 16;               // asteroids this small use the low vertex model
+const float FAR_DISTANCE = 250.0f;         // asteroids further than this from the ship count as distant
+const float HUD_REFRESH_INTERVAL = 0.25f;  // seconds between text texture updates at reduced HUD quality
+const float DEFAULT_TARGET_FPS = 60.0f;    // frame rate the quality governor tries to hold
+
+const int MAX_SUB_STEPS = 8; // upper bound on asteroid physics sub-steps during a long frame
+
 class Asteroids : public GameEngine{
 private:
     int score;
@@ -23,6 +33,19 @@ private:
         int health;
         Color colour;
         float mass = size*2;
+        float skippedTime = 0.0f; // simulation time not yet applied because the object was sub-sampled
+        float frameStep = 0.0f; // simulation time applied to the object this frame
+        bool far = false; // far from the ship, only worked out at reduced quality
+        bool skipped = false; // sub-sampled this frame, so it is neither moved nor collided
+        bool fast = false; // moves far enough this frame to need collision sub-steps
+        float prevX = 0.0f; // x pos at the start of the frame
+        float prevY = 0.0f; // y pos at the start of the frame
+    };
+    // a swept collision of the ship or a bullet with an asteroid, t is the fraction of the frame when it happens
+    struct Hit{
+        float t;
+        SpaceObject *mover;
+        SpaceObject *asteroid;
     };
     std::vector<SpaceObject> vecAsteroids;
     std::vector<SpaceObject> vecBullets;
@@ -30,9 +53,15 @@ private:
     // model objects which contain initial coordinates to draw the corresponding objects on screen.
     std::vector<std::pair<float, float>> vecModelShip;
     std::vector<std::pair<float, float>> vecModelAsteroid;
+    std::vector<std::pair<float, float>> vecModelAsteroidLow;
+    // HUD textures are kept across frames so they can be refreshed less often
+    LTexture scoreTexture;
+    LTexture gameOverTexture;
+    float hudRefreshTimer;
+    int frameCount;
 
 public:
-    Asteroids(): score(0), mAcceleration(100.0f), bulletSpeed(180.0f), dead(false){}
+    Asteroids(): score(0), mAcceleration(100.0f), bulletSpeed(180.0f), dead(false), hudRefreshTimer(0.0f), frameCount(0){}
 
     bool onInit() override{
         int iSize = 32;
@@ -61,6 +90,11 @@ public:
             float seg_angle = 6.28318f * (float(i)) / (float(verts)); // portion of 2*PI
             vecModelAsteroid.emplace_back(radius * std::sin(seg_angle), radius*std::cos(seg_angle));
         }
+        int lowVerts = 8; // cheaper model for small or distant asteroids at reduced quality
+        for(int i = 0; i < lowVerts; i++) {
+            float seg_angle = 6.28318f * (float(i)) / (float(lowVerts));
+            vecModelAsteroidLow.emplace_back(std::sin(seg_angle), std::cos(seg_angle));
+        }
 
         return true;
     }
@@ -73,6 +107,16 @@ public:
         if (iy < 0.0f)	oy = iy + (float)mWindowHeight;
         if (iy >= (float)mWindowHeight) oy = iy - (float)mWindowHeight;
     }
+    // Maps an offset between two positions to the shortest one on the wrapped screen
+    void WrapDelta(float ix, float iy, float &ox, float &oy)
+    {
+        ox = ix;
+        oy = iy;
+        if (ix < -0.5f * (float)mWindowWidth)	ox = ix + (float)mWindowWidth;
+        if (ix > 0.5f * (float)mWindowWidth)	ox = ix - (float)mWindowWidth;
+        if (iy < -0.5f * (float)mWindowHeight)	oy = iy + (float)mWindowHeight;
+        if (iy > 0.5f * (float)mWindowHeight)	oy = iy - (float)mWindowHeight;
+    }
     bool drawPoint(int x, int y, Color color = {0xFF, 0xFF, 0xFF}) override{
         float fx, fy;
         WrapCoordinates(x, y, fx, fy);
@@ -108,10 +152,9 @@ public:
         // If we want to move an object by 5 m/s, then in each frame, we move it by 5 / FPS.
         // where FPS = 1 / secPerFrame. So essentially, we move it by 5 * secPerFrame.
 
-        // utility function
-        auto doCirclesOverlap = [](float x1, float y1, float r1, float x2, float y2, float r2 ) -> bool {
-            return (x1-x2)*(x1-x2) + (y1-y2)*(y1-y2) <= (r1+r2)*(r1+r2);
-        };
+        // remember where the ship started so its collisions can be swept along the path travelled this frame
+        player.prevX = player.x;
+        player.prevY = player.y;
 
         // x2 = x1 + v*t
         player.x += player.velX * secPerFrame;
@@ -119,21 +162,232 @@ public:
 
         WrapCoordinates(player.x, player.y, player.x, player.y);
 
-        std::vector<std::pair<SpaceObject *, SpaceObject *>> vecCollidingAsteroids;
+        // decide how much simulation time each asteroid advances by this frame
+        int quality = getQualityLevel();
+        frameCount++;
+        float minSize = 0.0f;
+        for(auto &a : vecAsteroids){
+            if(minSize == 0.0f || a.size < minSize){
+                minSize = a.size;
+            }
+        }
+        float maxDisplacement = 0.0f;
+        for(auto &a : vecAsteroids){
+            a.prevX = a.x;
+            a.prevY = a.y;
+            a.far = quality >= QUALITY_REDUCED_LOD && isFarFromPlayer(a);
+            // distant asteroids are only simulated on alternate frames, catching up on the skipped time.
+            // Skipped ones also sit out the pairwise collision pass, which is where the simulation cost is
+            a.skipped = quality >= QUALITY_SUBSAMPLED && a.far && (frameCount + a.id) % 2 != 0;
+            if(a.skipped){
+                a.skippedTime += secPerFrame;
+                a.frameStep = 0.0f;
+            } else {
+                a.frameStep = secPerFrame + a.skippedTime;
+                a.skippedTime = 0.0f;
+            }
+            // judge speed by this frame's time only, the catch-up of a sub-sampled asteroid isn't real speed
+            float displacement = std::sqrt(a.velX*a.velX + a.velY*a.velY) * secPerFrame;
+            a.fast = !a.skipped && displacement > 0.5f * minSize;
+            if(a.fast){
+                maxDisplacement = std::max(maxDisplacement, displacement);
+            }
+        }
+
+        // asteroids only collide where they end up, so a long frame could carry them through each other.
+        // Two asteroids that each move less than half the smallest radius can't pass through each other, so the frame
+        // is only split into sub-steps when some asteroid is faster than that. Every asteroid still moves in each
+        // sub-step, but after the first only the fast ones are tested again, each against all asteroids (fast * n pairs).
+        // The ship and bullets don't need this since their collisions are swept
+        int nSubSteps = 1;
+        if(maxDisplacement > 0.0f){
+            nSubSteps = std::min(MAX_SUB_STEPS, static_cast<int>(std::ceil(maxDisplacement / (0.5f * minSize))));
+        }
+        for(int i = 0; i < nSubSteps; i++){
+            resolveAsteroidCollisions(i > 0);
+            for(auto &a : vecAsteroids){
+                float step = a.frameStep / nSubSteps;
+                a.x += (a.velX * step);
+                a.y += (a.velY * step);
+                WrapCoordinates(a.x, a.y, a.x, a.y);
+            }
+        }
 
-        // check ship collision with asteroids
+        // collect ship collisions with asteroids along the path both travelled this frame,
+        // they are applied together with the bullet hits in time order below
+        std::vector<Hit> vecHits;
         for(auto &a: vecAsteroids){
-            if(isPointInsideCircle(a.x, a.y, a.size, player.x, player.y)){
+            float t;
+            if(sweepAgainstCircle(player, a, t)){
+                vecHits.push_back({t, &player, &a});
+            }
+        }
+
+        // draw asteroids
+        for(auto &a : vecAsteroids){
+            // extrapolate sub-sampled asteroids so they still appear to move smoothly
+            float drawX, drawY;
+            WrapCoordinates(a.x + a.velX * a.skippedTime, a.y + a.velY * a.skippedTime, drawX, drawY);
+            bool useLowModel = quality >= QUALITY_REDUCED_LOD && (a.size <= LOD_MAX_SIZE || a.far);
+            bool fill = quality < QUALITY_OUTLINE_ONLY;
+            DrawWireFrameModel(useLowModel ? vecModelAsteroidLow : vecModelAsteroid, drawX, drawY, a.angle, a.size, fill, a.colour);
+        }
+
+        // draw bullets
+        for(auto &b : vecBullets){
+            b.prevX = b.x;
+            b.prevY = b.y;
+            b.x += (b.velX * secPerFrame);
+            b.y += (b.velY * secPerFrame);
+            b.angle -= 1.0f * secPerFrame;
+//            WrapCoordinates(b.x, b.y, b.x, b.y);
+            drawPoint(b.x, b.y);
+
+            // collect collisions with asteroids
+            for (auto &a: vecAsteroids){
+                float t;
+                if(sweepAgainstCircle(b, a, t)){
+                    vecHits.push_back({t, &b, &a});
+                }
+            }
+        }
+
+        // apply hits in order of time of impact across the ship and all bullets, so a bullet that destroys an asteroid
+        // first also saves the ship, and each bullet only counts against the first asteroid it reaches
+        std::sort(vecHits.begin(), vecHits.end(), [](const Hit &h1, const Hit &h2){ return h1.t < h2.t; });
+        std::vector<SpaceObject *> vecUsedBullets;
+        std::vector<SpaceObject> newAsteroids;
+        for(auto &h : vecHits){
+            SpaceObject &a = *h.asteroid;
+            if(a.x < 0){
+                // destroyed by an earlier hit this frame
+                continue;
+            }
+            if(h.mover == &player){
                 dead = true;
+                continue;
+            }
+            SpaceObject &b = *h.mover;
+            if(std::find(vecUsedBullets.begin(), vecUsedBullets.end(), &b) != vecUsedBullets.end()){
+                continue;
             }
+            vecUsedBullets.push_back(&b);
+
+            // collision with asteroid
+            b.x = -100;
+            a.health -= 100;
+            if(a.health <= 0){
+                score += 20;
+                if(a.size > 16){
+                    float rand_angle = static_cast <float> (rand()) / (static_cast <float> (RAND_MAX/6.28318f));
+                    newAsteroids.push_back({CURRENT_ID++,a.x+10, a.y+10, a.velX * std::sin(rand_angle), a.velY * std::cos(rand_angle), a.size/2, 0, (a.size/2)*10, a.colour});
+                    rand_angle = static_cast <float> (rand()) / (static_cast <float> (RAND_MAX/6.28318f));
+                    newAsteroids.push_back({CURRENT_ID++,a.x-10, a.y-10, a.velX * std::sin(rand_angle), a.velY * std::cos(rand_angle), a.size/2, 0, (a.size/2)*10, a.colour});
+                }
+                a.x = -100;
+            }
+        }
+
+        for(auto a: newAsteroids){
+            vecAsteroids.push_back(a);
+        }
+
+        // remove bullets which are off the screen
+        if(!vecBullets.empty()){
+            auto it = std::remove_if(vecBullets.begin(), vecBullets.end(),
+                                     [&](SpaceObject o){
+                return (o.x <1 || o.y < 1 || o.x >= mWindowWidth || o.y >= mWindowHeight);});
+            vecBullets.erase(it, vecBullets.end());
+        }
+
+        // remove asteroids which are off the screen
+        if(!vecAsteroids.empty()){
+            auto it = std::remove_if(vecAsteroids.begin(), vecAsteroids.end(),
+                                     [&](SpaceObject o){ return (o.x < 0 ); });
+            vecAsteroids.erase(it, vecAsteroids.end());
         }
+        // draw ship
+        DrawWireFrameModel(vecModelShip, player.x, player.y, player.angle);
+
+        hudRefreshTimer += secPerFrame;
+        if(quality < QUALITY_REDUCED_HUD || hudRefreshTimer >= HUD_REFRESH_INTERVAL){
+            scoreTexture.loadTextureFromText("Score: " + std::to_string(score));
+            hudRefreshTimer = 0.0f;
+        }
+        scoreTexture.render(2,2);
+        if(dead){
+            if(gameOverTexture.getWidth() == 0){
+                gameOverTexture.loadTextureFromText("Game Over Kiddo!");
+            }
+            gameOverTexture.render(mWindowWidth/2, mWindowHeight/2);
+        }
+        return true;
+    }
+
+    bool isFarFromPlayer(const SpaceObject &o)
+    {
+        float dx, dy;
+        WrapDelta(o.x - player.x, o.y - player.y, dx, dy);
+        return dx*dx + dy*dy > FAR_DISTANCE*FAR_DISTANCE;
+    }
+
+    // Finds the earliest time t in [0, 1] at which a point starting at (px, py) relative to a circle's centre
+    // and moving by (dx, dy) touches the circle.
+    // Solving |p + t*d|^2 = r^2 gives the quadratic (d.d)t^2 + 2(p.d)t + (p.p - r^2) = 0, the smaller root is the entry time
+    bool sweepPointCircle(float px, float py, float dx, float dy, float radius, float &t)
+    {
+        float c = px*px + py*py - radius*radius;
+        if(c < 0.0f){
+            // already inside at the start of the step
+            t = 0.0f;
+            return true;
+        }
+        float a = dx*dx + dy*dy;
+        float b = px*dx + py*dy;
+        if(a == 0.0f || b >= 0.0f){
+            // not moving relative to the circle, or moving away from it
+            return false;
+        }
+        float discriminant = b*b - a*c;
+        if(discriminant < 0.0f){
+            return false;
+        }
+        t = (-b - std::sqrt(discriminant)) / a;
+        return t <= 1.0f;
+    }
+
+    // Sweeps object o (treated as a point) against circle object c over the frame, using the motion of both.
+    // Offsets go through WrapDelta so an object crossing a screen edge is matched against the nearest copy of the other
+    bool sweepAgainstCircle(const SpaceObject &o, const SpaceObject &c, float &t)
+    {
+        float startX, startY, moveOX, moveOY, moveCX, moveCY;
+        WrapDelta(o.prevX - c.prevX, o.prevY - c.prevY, startX, startY);
+        WrapDelta(o.x - o.prevX, o.y - o.prevY, moveOX, moveOY);
+        WrapDelta(c.x - c.prevX, c.y - c.prevY, moveCX, moveCY);
+        return sweepPointCircle(startX, startY, moveOX - moveCX, moveOY - moveCY, c.size, t);
+    }
+
+    // Pushes overlapping asteroids apart and bounces them off each other.
+    // With fastOnly set, only fast asteroids are tested, each against all the others
+    void resolveAsteroidCollisions(bool fastOnly = false)
+    {
+        // utility function
+        auto doCirclesOverlap = [](float x1, float y1, float r1, float x2, float y2, float r2 ) -> bool {
+            return (x1-x2)*(x1-x2) + (y1-y2)*(y1-y2) <= (r1+r2)*(r1+r2);
+        };
+
+        std::vector<std::pair<SpaceObject *, SpaceObject *>> vecCollidingAsteroids;
 
         for(auto &ast1: vecAsteroids){
+            // in a fast-only pass only fast asteroids start the inner loop, so it costs fast * n pair tests
+            if(ast1.skipped || (fastOnly && !ast1.fast)){
+                continue;
+            }
             for(auto &ast2: vecAsteroids) {
-                if(ast1.id != ast2.id) {
+                if(ast1.id != ast2.id && !ast2.skipped) {
                     if (doCirclesOverlap(ast1.x, ast1.y, ast1.size, ast2.x, ast2.y, ast2.size)) {
                         vecCollidingAsteroids.emplace_back(&ast1, &ast2);
-                        
+                    
                         // resolving static collision
                         float fDistance = std::sqrt(
                                 (ast1.x - ast2.x) * (ast1.x - ast2.x) + (ast1.y - ast2.y) * (ast1.y - ast2.y));
@@ -189,84 +443,6 @@ public:
             b2->velY = fDotTang2 * ty + v2_scalar * ny;
 
         }
-
-        //  update and draw asteroids
-        for(auto &a : vecAsteroids){
-            a.x += (a.velX * secPerFrame);
-            a.y += (a.velY * secPerFrame);
-            WrapCoordinates(a.x, a.y, a.x, a.y);
-            DrawWireFrameModel(vecModelAsteroid, a.x, a.y, a.angle, a.size, true, a.colour);
-        }
-
-        std::vector<SpaceObject> newAsteroids;
-
-        // draw bullets
-        for(auto &b : vecBullets){
-            b.x += (b.velX * secPerFrame);
-            b.y += (b.velY * secPerFrame);
-            b.angle -= 1.0f * secPerFrame;
-//            WrapCoordinates(b.x, b.y, b.x, b.y);
-            drawPoint(b.x, b.y);
-
-            // check collision with asteroids
-
-            for (auto &a: vecAsteroids){
-                if(isPointInsideCircle(a.x, a.y, a.size, b.x, b.y)){
-                    // collision with asteroid
-                    b.x = -100;
-                    a.health -= 100;
-                    if(a.health <= 0){
-                        score += 20;
-                        if(a.size > 16){
-                            float rand_angle = static_cast <float> (rand()) / (static_cast <float> (RAND_MAX/6.28318f));
-                            newAsteroids.push_back({CURRENT_ID++,a.x+10, a.y+10, a.velX * std::sin(rand_angle), a.velY * std::cos(rand_angle), a.size/2, 0, (a.size/2)*10, a.colour});
-                            rand_angle = static_cast <float> (rand()) / (static_cast <float> (RAND_MAX/6.28318f));
-                            newAsteroids.push_back({CURRENT_ID++,a.x-10, a.y-10, a.velX * std::sin(rand_angle), a.velY * std::cos(rand_angle), a.size/2, 0, (a.size/2)*10, a.colour});
-                        }
-                        a.x = -100;
-                    }
-                }
-            }
-        }
-
-        for(auto a: newAsteroids){
-            vecAsteroids.push_back(a);
-        }
-
-        // remove bullets which are off the screen
-        if(!vecBullets.empty()){
-            auto it = std::remove_if(vecBullets.begin(), vecBullets.end(),
-                                     [&](SpaceObject o){
-                return (o.x <1 || o.y < 1 || o.x >= mWindowWidth || o.y >= mWindowHeight);});
-            if(it != vecBullets.end()){
-                vecBullets.erase(it);
-            }
-        }
-
-        // remove asteroids which are off the screen
-        if(!vecAsteroids.empty()){
-            auto it = std::remove_if(vecAsteroids.begin(), vecAsteroids.end(),
-                                     [&](SpaceObject o){ return (o.x < 0 ); });
-            if(it != vecAsteroids.end()){
-                vecAsteroids.erase(it);
-            }
-        }
-        // draw ship
-        DrawWireFrameModel(vecModelShip, player.x, player.y, player.angle);
-
-        LTexture texture;
-        texture.loadTextureFromText("Score: " + std::to_string(score));
-        texture.render(2,2);
-        if(dead){
-            texture.loadTextureFromText("Game Over Kiddo!");
-            texture.render(mWindowWidth/2, mWindowHeight/2);
-        }
-        return true;
-    }
-
-    bool isPointInsideCircle(float cx, float cy, float radius, float x, float y)
-    {
-        return (x-cx)*(x-cx) + (y-cy)*(y-cy) < radius * radius;
     }
 
     void DrawWireFrameModel(const std::vector<std::pair<float, float>> &vecModelCoordinates, float x, float y, float r = 0.0f, float s = 1.0f, bool fillCircle = false, Color color = {0xFF, 0xFF, 0xFF})
@@ -332,6 +508,17 @@ public:
 int main(int argc, char *args[]) {
     Asteroids asteroids;
     asteroids.constructConsole(800, 450, "Asteroids");
+    // optional first argument overrides the target frame rate, e.g. 30 on weak hardware
+    float targetFps = DEFAULT_TARGET_FPS;
+    if(argc > 1){
+        float requestedFps = std::atof(args[1]);
+        if(requestedFps > 0.0f){
+            targetFps = requestedFps;
+        } else {
+            std::cout << "Invalid target fps argument: " << args[1] << ", using " << DEFAULT_TARGET_FPS << std::endl;
+        }
+    }
+    asteroids.setTargetFrameTime(1.0f / targetFps);
     asteroids.startGameLoop();
 
     return 0;